@@ -3,7 +3,9 @@
 
 #include "message.h"
 
+#ifndef MAX_CACHE_SIZE // Shared with the other cache header
 #define MAX_CACHE_SIZE 16 // Maximum number of messages in cache
+#endif
 
 // I implement my LRU cache as a hash table combining with doubly linked list. In double linked list, each node 
 //will contain a Message object and 2 pointers: prev and next which pointing to the previous node and the next  
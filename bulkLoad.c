@@ -0,0 +1,419 @@
+#include "bulkLoad.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_CHUNK_SIZE (64 * 1024) // Smaller chunks cost more in thread startup than they save
+#define MAX_THREADS 256
+
+// A parsed record waiting to be merged. The ID, sender and receiver are read back from the mapped file and
+// their hashes computed again by the merges, which keeps the temporary memory at about 44 bytes per record.
+typedef struct {
+    long offset;                // Byte offset of the record in the store file.
+    int length;                 // Length of the record, without the newline.
+    int sender_start;           // Offset of the sender in the record, the receiver follows it and a delimiter.
+    int sender_length;
+    int receiver_length;
+    unsigned char id_length;    // The ID starts the record.
+    unsigned char delivered;
+} RecordRef;
+
+// Everything one thread reads and produces, so the threads share nothing while they run
+typedef struct {
+    const char* data;   // Start of the mapped file.
+    size_t begin;       // First byte of the chunk, always the start of a record.
+    size_t end;         // One past the last byte of the chunk.
+    int* pending[INDEX_SHARDS]; // Positions in records, by ID shard, in file order.
+    int pending_count[INDEX_SHARDS];
+    int pending_capacity[INDEX_SHARDS];
+    RecordRef* records; // Every record of the chunk, in file order.
+    int record_count;   // Records found in the chunk.
+    int record_capacity;
+    int* postings_pending[2][POSTINGS_SHARDS]; // Positions in records, by field and postings shard, in file order.
+    int postings_pending_count[2][POSTINGS_SHARDS];
+    int postings_pending_capacity[2][POSTINGS_SHARDS];
+    int failed;         // Set if the thread ran out of memory.
+} ChunkJob;
+
+// The shards one thread merges from every chunk
+typedef struct {
+    MessageIndex* index;
+    ChunkJob* jobs;
+    int job_count;
+    int first_shard;    // The thread merges shards first_shard, first_shard + stride, ...
+    int stride;
+    int added;          // IDs the thread added to the index, records replacing an indexed ID not included.
+    int failed;
+} MergeJob;
+
+// Forward declaration of private helper functions
+static void* parse_chunk(void* arg);
+static void* merge_shards(void* arg);
+static void* merge_postings(void* arg);
+static void run_in_threads(void* (*work)(void*), void* jobs, size_t job_size, int count, pthread_t* threads);
+static int add_record(ChunkJob* job, const RecordRef* record);
+static int add_position(int** positions, int* count, int* capacity, int record);
+static void warm_cache_from_jobs(LRUCache* cache, const char* data, ChunkJob* jobs, int job_count);
+static int online_cores();
+
+// Load every record of a store file into an index, and optionally warm a cache with the newest messages
+int bulk_load_store(const char* path, MessageIndex* index, LRUCache* warm_cache, int num_threads) {
+    if (!path || !index) {
+        fprintf(stderr, "Error: Store path or index is NULL.\n");
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error: Unable to open file for reading");
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        perror("Error: Unable to read file size");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)info.st_size;
+    if (size == 0) {
+        close(fd);
+        return 0; // Nothing to load
+    }
+
+    const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (data == MAP_FAILED) {
+        perror("Error: Unable to map file");
+        return -1;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    // By default one thread per core, but never so many that chunks get tiny. An explicit count is honored.
+    if (num_threads <= 0) {
+        num_threads = online_cores();
+        if ((size_t)num_threads > size / MIN_CHUNK_SIZE) {
+            num_threads = (int)(size / MIN_CHUNK_SIZE);
+        }
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
+    }
+
+    ChunkJob* jobs = calloc(num_threads, sizeof(ChunkJob));
+    MergeJob* merges = calloc(num_threads, sizeof(MergeJob));
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    if (!jobs || !merges || !threads) {
+        free(jobs);
+        free(merges);
+        free(threads);
+        munmap((void*)data, size);
+        return -1; // Memory allocation failed
+    }
+
+    // Split the file into chunks that each start right after a newline
+    size_t begin = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        size_t end = (i == num_threads - 1) ? size : size / num_threads * (i + 1);
+        if (end < begin) {
+            end = begin;
+        }
+        const char* newline = (end < size) ? memchr(data + end, '\n', size - end) : NULL;
+        end = newline ? (size_t)(newline - data) + 1 : size;
+        jobs[i].data = data;
+        jobs[i].begin = begin;
+        jobs[i].end = end;
+        begin = end;
+    }
+
+    // Parse phase: every thread scans its own chunk
+    run_in_threads(parse_chunk, jobs, sizeof(ChunkJob), num_threads, threads);
+
+    int failed = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        failed |= jobs[i].failed;
+    }
+
+    // Merge phases: every thread owns a disjoint set of ID shards, then of postings shards. The postings merge
+    // runs second so the ID index can tell which record of an ID is the newest.
+    for (int i = 0; i < num_threads; ++i) {
+        merges[i].index = index;
+        merges[i].jobs = jobs;
+        merges[i].job_count = num_threads;
+        merges[i].first_shard = i;
+        merges[i].stride = num_threads;
+    }
+    void* (*merge_phases[])(void*) = { merge_shards, merge_postings };
+    for (int phase = 0; phase < 2 && !failed; ++phase) {
+        run_in_threads(merge_phases[phase], merges, sizeof(MergeJob), num_threads, threads);
+        for (int i = 0; i < num_threads; ++i) {
+            failed |= merges[i].failed;
+        }
+    }
+
+    if (!failed && warm_cache) {
+        warm_cache_from_jobs(warm_cache, data, jobs, num_threads);
+    }
+
+    int added = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        added += merges[i].added;
+        free(jobs[i].records);
+        for (int s = 0; s < INDEX_SHARDS; ++s) {
+            free(jobs[i].pending[s]);
+        }
+        for (int s = 0; s < POSTINGS_SHARDS; ++s) {
+            free(jobs[i].postings_pending[BY_RECEIVER][s]);
+            free(jobs[i].postings_pending[BY_SENDER][s]);
+        }
+    }
+
+    free(jobs);
+    free(merges);
+    free(threads);
+    munmap((void*)data, size);
+    return failed ? -1 : added;
+}
+
+// Find every record of one chunk and sort it by shard
+static void* parse_chunk(void* arg) {
+    ChunkJob* job = (ChunkJob*)arg;
+    const char* data = job->data;
+    size_t position = job->begin;
+
+    while (position < job->end) {
+        const char* line = data + position;
+        const char* newline = memchr(line, '\n', job->end - position);
+        size_t length = newline ? (size_t)(newline - line) : job->end - position;
+        position += length + 1;
+
+        // Only the fields that are indexed are needed now, the rest of the record is parsed on demand
+        const char* fields[MSG_FIELD_COUNT];
+        size_t lengths[MSG_FIELD_COUNT];
+        int field_count = split_msg_line(line, length, fields, lengths);
+        size_t id_length = lengths[MSG_FIELD_ID];
+        if (field_count <= MSG_FIELD_CONTENT || id_length == 0 || id_length >= ID_SIZE) {
+            continue; // Empty or malformed line
+        }
+
+        RecordRef record;
+        record.offset = (long)(line - data);
+        record.length = (int)length;
+        record.sender_start = (int)(fields[MSG_FIELD_SENDER] - line);
+        record.sender_length = (int)lengths[MSG_FIELD_SENDER];
+        record.receiver_length = (int)lengths[MSG_FIELD_RECEIVER];
+        record.id_length = (unsigned char)id_length;
+        record.delivered = (field_count == MSG_FIELD_COUNT && fields[MSG_FIELD_DELIVERED][0] == '1');
+
+        // The hashes only pick the shards here, the merges compute them again rather than keep them
+        int shard = message_index_hash(line, id_length) & (INDEX_SHARDS - 1);
+        int receiver_shard = message_index_hash(fields[MSG_FIELD_RECEIVER], record.receiver_length) &
+                             (POSTINGS_SHARDS - 1);
+        int sender_shard = message_index_hash(fields[MSG_FIELD_SENDER], record.sender_length) & (POSTINGS_SHARDS - 1);
+
+        int position_in_chunk = job->record_count;
+        if (add_record(job, &record) != 0 ||
+            add_position(&job->pending[shard], &job->pending_count[shard], &job->pending_capacity[shard],
+                         position_in_chunk) != 0 ||
+            add_position(&job->postings_pending[BY_RECEIVER][receiver_shard],
+                         &job->postings_pending_count[BY_RECEIVER][receiver_shard],
+                         &job->postings_pending_capacity[BY_RECEIVER][receiver_shard], position_in_chunk) != 0 ||
+            add_position(&job->postings_pending[BY_SENDER][sender_shard],
+                         &job->postings_pending_count[BY_SENDER][sender_shard],
+                         &job->postings_pending_capacity[BY_SENDER][sender_shard], position_in_chunk) != 0) {
+            job->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Merge the shards owned by one thread from every chunk, in file order
+static void* merge_shards(void* arg) {
+    MergeJob* merge = (MergeJob*)arg;
+
+    for (int s = merge->first_shard; s < INDEX_SHARDS; s += merge->stride) {
+        IndexShard* shard = &merge->index->shards[s];
+
+        // Size the shard once so the merge never rehashes
+        int total = shard->count;
+        for (int j = 0; j < merge->job_count; ++j) {
+            total += merge->jobs[j].pending_count[s];
+        }
+        if (total > 0 && index_shard_reserve(shard, total) != 0) {
+            merge->failed = 1;
+            return NULL;
+        }
+
+        for (int j = 0; j < merge->job_count; ++j) {
+            const ChunkJob* job = &merge->jobs[j];
+            for (int k = 0; k < job->pending_count[s]; ++k) {
+                const RecordRef* record = &job->records[job->pending[s][k]];
+                const char* line = job->data + record->offset;
+
+                IndexEntry entry;
+                memcpy(entry.id, line, record->id_length);
+                entry.id[record->id_length] = '\0';
+                entry.offset = record->offset;
+                entry.length = record->length;
+                entry.sender_list = NULL; // Set by the postings merge
+                entry.receiver_list = NULL;
+                int result = index_shard_add(shard, message_index_hash(line, record->id_length), &entry);
+                if (result < 0) {
+                    merge->failed = 1;
+                    return NULL;
+                }
+                merge->added += result == 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Merge the postings shards owned by one thread from every chunk, chunks in file order keep every list sorted
+static void* merge_postings(void* arg) {
+    MergeJob* merge = (MergeJob*)arg;
+    MessageIndex* index = merge->index;
+
+    for (int s = merge->first_shard; s < POSTINGS_SHARDS; s += merge->stride) {
+        for (int field = BY_RECEIVER; field <= BY_SENDER; ++field) {
+            PostingsShard* shard = field == BY_SENDER ? &index->by_sender.shards[s] : &index->by_receiver.shards[s];
+
+            for (int j = 0; j < merge->job_count; ++j) {
+                const ChunkJob* job = &merge->jobs[j];
+                for (int k = 0; k < job->postings_pending_count[field][s]; ++k) {
+                    const RecordRef* record = &job->records[job->postings_pending[field][s][k]];
+                    const char* line = job->data + record->offset;
+
+                    // Only the record the ID index kept is visible to queries
+                    char id[ID_SIZE];
+                    memcpy(id, line, record->id_length);
+                    id[record->id_length] = '\0';
+                    unsigned long hash = message_index_hash(id, record->id_length);
+                    IndexEntry* entry = index_shard_find(&index->shards[hash & (INDEX_SHARDS - 1)], hash, id);
+                    Posting posting = { record->offset, record->length, record->delivered, 0 };
+                    posting.superseded = !entry || entry->offset != posting.offset;
+
+                    const char* key = line + record->sender_start;
+                    int key_length = record->sender_length;
+                    if (field == BY_RECEIVER) {
+                        key += record->sender_length + 1;
+                        key_length = record->receiver_length;
+                    }
+                    PostingsList* list = postings_shard_add(shard, message_index_hash(key, key_length), key,
+                                                            key_length, &posting);
+                    if (!list) {
+                        merge->failed = 1;
+                        return NULL;
+                    }
+
+                    // The owner of the receiver shard and the owner of the sender shard set different fields
+                    if (!posting.superseded && field == BY_SENDER) {
+                        entry->sender_list = list;
+                    } else if (!posting.superseded) {
+                        entry->receiver_list = list;
+                    }
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+// Run one job per thread and wait for all of them
+static void run_in_threads(void* (*work)(void*), void* jobs, size_t job_size, int count, pthread_t* threads) {
+    int started = 0;
+    for (; started < count; ++started) {
+        if (pthread_create(&threads[started], NULL, work, (char*)jobs + started * job_size) != 0) {
+            break;
+        }
+    }
+    for (int i = started; i < count; ++i) {
+        work((char*)jobs + i * job_size); // Could not start a thread, do the work here instead
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Append the position of a record to one pending list
+static int add_position(int** positions, int* count, int* capacity, int record) {
+    if (*count == *capacity) {
+        int grown_capacity = *capacity ? *capacity * 2 : 64;
+        int* grown = realloc(*positions, grown_capacity * sizeof(int));
+        if (!grown) {
+            return -1; // Memory allocation failed
+        }
+        *positions = grown;
+        *capacity = grown_capacity;
+    }
+
+    (*positions)[(*count)++] = record;
+    return 0;
+}
+
+// Append a record to the list of its chunk
+static int add_record(ChunkJob* job, const RecordRef* record) {
+    if (job->record_count == job->record_capacity) {
+        int capacity = job->record_capacity ? job->record_capacity * 2 : 256;
+        RecordRef* records = realloc(job->records, capacity * sizeof(RecordRef));
+        if (!records) {
+            return -1; // Memory allocation failed
+        }
+        job->records = records;
+        job->record_capacity = capacity;
+    }
+
+    job->records[job->record_count++] = *record;
+    return 0;
+}
+
+// Put the newest messages of the file into a cache, the newest one ends up most recently used
+static void warm_cache_from_jobs(LRUCache* cache, const char* data, ChunkJob* jobs, int job_count) {
+    Message* warm[MAX_CACHE_SIZE];
+    int warm_count = 0;
+
+    // Walk the chunks backwards, each from its newest record, until the cache would be full
+    for (int j = job_count - 1; j >= 0 && warm_count < MAX_CACHE_SIZE; --j) {
+        const ChunkJob* job = &jobs[j];
+
+        for (int k = job->record_count - 1; k >= 0 && warm_count < MAX_CACHE_SIZE; --k) {
+            const RecordRef* record = &job->records[k];
+            Message* msg = parse_msg(data + record->offset, record->length);
+            if (!msg) {
+                continue;
+            }
+
+            // Only the newest record of an ID belongs in the cache
+            int duplicate = 0;
+            for (int w = 0; w < warm_count && !duplicate; ++w) {
+                duplicate = strcmp(warm[w]->id, msg->id) == 0;
+            }
+            if (duplicate) {
+                free_msg(msg);
+                continue;
+            }
+            warm[warm_count++] = msg;
+        }
+    }
+
+    for (int w = warm_count - 1; w >= 0; --w) {
+        if (LRUCache_put(cache, warm[w])) {
+            free_msg(warm[w]); // Already cached, the cache only took a copy of the content
+        }
+    }
+}
+
+// Number of cores available to this process
+static int online_cores() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
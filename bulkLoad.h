@@ -0,0 +1,22 @@
+#ifndef BULKLOAD_H
+#define BULKLOAD_H
+
+#include "message.h"
+#include "messageIndex.h"
+
+// The bulk loader bootstraps a node from an existing store file in one pass instead of calling retrieve_msg()
+// once per ID, which rescans the file every time. The file is mapped into memory and split into one chunk per
+// thread, each chunk starting right after a newline so no record is cut in two. Every thread parses its own
+// chunk and sorts the records it finds by index shard. Then every thread merges a disjoint group of shards
+// from all the chunks, in file order so the newest record of an ID wins. No two threads ever touch the same
+// shard, so neither phase needs a lock and both scale with the number of cores. The receiver and sender postings
+// indexes are sharded by key the same way and merged in a second round once the ID shards are done, so every
+// record the ID index replaced can be flagged as superseded.
+
+// Load every record of a store file into an index, and optionally warm a cache with the newest messages.
+// A thread count of 0 or less uses every online core, fewer if the file is too small to be worth splitting.
+// Returns the number of distinct message IDs added to the index, -1 on error. A record whose ID is already
+// indexed, from an earlier load or earlier in the same file, replaces that entry and is not counted.
+int bulk_load_store(const char* path, MessageIndex* index, LRUCache* warm_cache, int num_threads);
+
+#endif /* BULKLOAD_H */
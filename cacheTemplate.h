@@ -0,0 +1,286 @@
+#ifndef CACHETEMPLATE_H
+#define CACHETEMPLATE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// LRUCache and randomCache are written for one key type, one value type and one size, and they reach the key
+// through strcmp and a hash function call on every access. This header generates a cache for any combination
+// of key, hash, value, capacity and eviction policy at compile time. Everything is static inline and the
+// policies are compile-time constants, so the compiler folds the unused policy away and inlines the hash and
+// the equality test. A cache with a fixed capacity keeps its storage inside the struct and all its masks are
+// constants, so a lookup is a few arithmetic operations and compares with no call through a pointer.
+
+// Storage is one array of slots and an open addressing hash table of slot positions, twice as large as the
+// capacity and probed linearly. Slots never move, so the LRU order is a doubly linked list of slot positions
+// instead of separately allocated nodes, and an eviction reuses the slot of the victim. Removing a key from
+// the table shifts the rest of its probe run back, so the table never fills up with tombstones.
+
+// The cache never frees values. put() hands back any value it replaced or evicted, so the caller decides.
+
+// Usage:
+//   DEFINE_CACHE(OffsetCache, unsigned long, long, cache_hash_ulong, cache_equal_ulong, 64, CACHE_EVICT_LRU)
+// defines the type OffsetCache and the functions OffsetCache_initialize, OffsetCache_free, OffsetCache_get,
+// OffsetCache_put and OffsetCache_size. A capacity of CACHE_RUNTIME_CAPACITY (0) takes the capacity from
+// OffsetCache_initialize instead, a fixed capacity must be a power of 2.
+
+#define CACHE_RUNTIME_CAPACITY 0 // Capacity chosen when the cache is initialized
+
+#define CACHE_EVICT_LRU 0    // Evict the least recently used entry
+#define CACHE_EVICT_RANDOM 1 // Evict a random entry
+
+// hash function to map a string key, djb2 like LRUCache with the low bits mixed for a power of 2 table
+static inline unsigned long cache_hash_string(const char* str) {
+    unsigned long hash = 5381;
+    int c;
+
+    while ((c = (unsigned char)*str++)) {
+        hash = ((hash << 5) + hash) + c; // hash * 33 + c
+    }
+    hash ^= hash >> 15;
+    hash *= 2654435761UL;
+    return hash ^ (hash >> 13);
+}
+
+static inline int cache_equal_string(const char* a, const char* b) {
+    return strcmp(a, b) == 0;
+}
+
+// hash function to map a numeric key, such as the number of a message ID
+static inline unsigned long cache_hash_ulong(unsigned long key) {
+    key ^= key >> 16;
+    key *= 2654435761UL;
+    return key ^ (key >> 13);
+}
+
+static inline int cache_equal_ulong(unsigned long a, unsigned long b) {
+    return a == b;
+}
+
+#define DEFINE_CACHE(name, key_t, value_t, hash_fn, equal_fn, capacity, eviction)                              \
+                                                                                                               \
+_Static_assert(((capacity) & ((capacity) - 1)) == 0, #name ": a fixed capacity must be a power of 2");         \
+                                                                                                               \
+typedef struct {                                                                                               \
+    key_t key;                                                                                                 \
+    value_t value;                                                                                             \
+    unsigned long hash; /* Hash of the key, kept so the table never has to call hash_fn again. */              \
+    int prev;           /* More recently used slot, -1 for the head. Unused by random eviction. */             \
+    int next;           /* Less recently used slot, -1 for the tail. Unused by random eviction. */             \
+} name##_slot;                                                                                                 \
+                                                                                                               \
+typedef struct {                                                                                               \
+    name##_slot fixed_slots[(capacity) ? (capacity) : 1];   /* Storage of a fixed capacity cache. */           \
+    int fixed_table[(capacity) ? 2 * (capacity) : 1];                                                          \
+    name##_slot* runtime_slots;                             /* Storage of a runtime capacity cache. */         \
+    int* runtime_table;                                                                                        \
+    int runtime_capacity;                                                                                      \
+    int runtime_mask;                                                                                          \
+    int size;               /* Number of slots in use, always the first ones. */                               \
+    int head;               /* Most recently used slot. */                                                     \
+    int tail;               /* Least recently used slot. */                                                    \
+    unsigned long long random_state;                                                                           \
+    unsigned long hit_count;                                                                                   \
+    unsigned long miss_count;                                                                                  \
+} name;                                                                                                        \
+                                                                                                               \
+/* With a fixed capacity each accessor folds to a constant or to storage inside the struct */                  \
+static inline name##_slot* name##_slots(name* cache) {                                                         \
+    return (capacity) ? cache->fixed_slots : cache->runtime_slots;                                             \
+}                                                                                                              \
+                                                                                                               \
+static inline int* name##_table(name* cache) {                                                                 \
+    return (capacity) ? cache->fixed_table : cache->runtime_table;                                             \
+}                                                                                                              \
+                                                                                                               \
+static inline int name##_capacity(const name* cache) {                                                         \
+    return (capacity) ? (capacity) : cache->runtime_capacity;                                                  \
+}                                                                                                              \
+                                                                                                               \
+static inline int name##_mask(const name* cache) {                                                             \
+    return (capacity) ? 2 * (capacity) - 1 : cache->runtime_mask;                                              \
+}                                                                                                              \
+                                                                                                               \
+/* Initialize a cache, the capacity is only used with CACHE_RUNTIME_CAPACITY. Returns 0 on success */          \
+static inline int name##_initialize(name* cache, int runtime_capacity) {                                       \
+    cache->runtime_slots = NULL;                                                                               \
+    cache->runtime_table = NULL;                                                                               \
+    cache->runtime_capacity = 0;                                                                               \
+    cache->runtime_mask = 0;                                                                                   \
+    if (!(capacity)) {                                                                                         \
+        if (runtime_capacity < 1) {                                                                            \
+            return -1;                                                                                         \
+        }                                                                                                      \
+        int table_size = 2;                                                                                    \
+        while (table_size < 2 * runtime_capacity) {                                                            \
+            table_size *= 2;                                                                                   \
+        }                                                                                                      \
+        cache->runtime_slots = malloc(runtime_capacity * sizeof(name##_slot));                                 \
+        cache->runtime_table = malloc(table_size * sizeof(int));                                               \
+        if (!cache->runtime_slots || !cache->runtime_table) {                                                  \
+            free(cache->runtime_slots);                                                                        \
+            free(cache->runtime_table);                                                                        \
+            return -1; /* Memory allocation failed */                                                          \
+        }                                                                                                      \
+        cache->runtime_capacity = runtime_capacity;                                                            \
+        cache->runtime_mask = table_size - 1;                                                                  \
+    }                                                                                                          \
+    memset(name##_table(cache), -1, (name##_mask(cache) + 1) * sizeof(int));                                   \
+    cache->size = 0;                                                                                           \
+    cache->head = -1;                                                                                          \
+    cache->tail = -1;                                                                                          \
+    cache->random_state = 88172645463325252ULL;                                                                \
+    cache->hit_count = 0;                                                                                      \
+    cache->miss_count = 0;                                                                                     \
+    return 0;                                                                                                  \
+}                                                                                                              \
+                                                                                                               \
+/* Free the storage of a cache, values are left to the caller */                                               \
+static inline void name##_free(name* cache) {                                                                  \
+    free(cache->runtime_slots);                                                                                \
+    free(cache->runtime_table);                                                                                \
+    cache->runtime_slots = NULL;                                                                               \
+    cache->runtime_table = NULL;                                                                               \
+    cache->size = 0;                                                                                           \
+}                                                                                                              \
+                                                                                                               \
+static inline int name##_size(const name* cache) {                                                             \
+    return cache->size;                                                                                        \
+}                                                                                                              \
+                                                                                                               \
+/* Table position holding a key, or the empty position where it would go */                                    \
+static inline int name##_probe(name* cache, key_t key, unsigned long hash) {                                   \
+    name##_slot* slots = name##_slots(cache);                                                                  \
+    int* table = name##_table(cache);                                                                          \
+    int mask = name##_mask(cache);                                                                             \
+    int position = (int)(hash & mask);                                                                         \
+                                                                                                               \
+    while (table[position] >= 0 &&                                                                             \
+           !(slots[table[position]].hash == hash && equal_fn(slots[table[position]].key, key))) {              \
+        position = (position + 1) & mask;                                                                      \
+    }                                                                                                          \
+    return position;                                                                                           \
+}                                                                                                              \
+                                                                                                               \
+/* Empty a table position and shift the rest of its probe run back */                                          \
+static inline void name##_remove_position(name* cache, int position) {                                         \
+    name##_slot* slots = name##_slots(cache);                                                                  \
+    int* table = name##_table(cache);                                                                          \
+    int mask = name##_mask(cache);                                                                             \
+    int next = position;                                                                                       \
+                                                                                                               \
+    table[position] = -1;                                                                                      \
+    for (;;) {                                                                                                 \
+        next = (next + 1) & mask;                                                                              \
+        if (table[next] < 0) {                                                                                 \
+            return;                                                                                            \
+        }                                                                                                      \
+        int home = (int)(slots[table[next]].hash & mask);                                                      \
+        /* Move the entry back unless its home lies cyclically in (position, next] */                          \
+        if (((next - home) & mask) >= ((next - position) & mask)) {                                            \
+            table[position] = table[next];                                                                     \
+            table[next] = -1;                                                                                  \
+            position = next;                                                                                   \
+        }                                                                                                      \
+    }                                                                                                          \
+}                                                                                                              \
+                                                                                                               \
+/* Remove a slot from the LRU list */                                                                          \
+static inline void name##_unlink(name* cache, name##_slot* slots, int slot) {                                  \
+    if (slots[slot].prev >= 0) {                                                                               \
+        slots[slots[slot].prev].next = slots[slot].next;                                                       \
+    } else {                                                                                                   \
+        cache->head = slots[slot].next;                                                                        \
+    }                                                                                                          \
+    if (slots[slot].next >= 0) {                                                                               \
+        slots[slots[slot].next].prev = slots[slot].prev;                                                       \
+    } else {                                                                                                   \
+        cache->tail = slots[slot].prev;                                                                        \
+    }                                                                                                          \
+}                                                                                                              \
+                                                                                                               \
+/* Put a slot at the front of the LRU list */                                                                  \
+static inline void name##_link_front(name* cache, name##_slot* slots, int slot) {                              \
+    slots[slot].prev = -1;                                                                                     \
+    slots[slot].next = cache->head;                                                                            \
+    if (cache->head >= 0) {                                                                                    \
+        slots[cache->head].prev = slot;                                                                        \
+    } else {                                                                                                   \
+        cache->tail = slot;                                                                                    \
+    }                                                                                                          \
+    cache->head = slot;                                                                                        \
+}                                                                                                              \
+                                                                                                               \
+/* Get the value of a key, NULL on a miss. The pointer is valid until the next put */                          \
+static inline value_t* name##_get(name* cache, key_t key) {                                                    \
+    name##_slot* slots = name##_slots(cache);                                                                  \
+    int slot = name##_table(cache)[name##_probe(cache, key, hash_fn(key))];                                    \
+                                                                                                               \
+    if (slot < 0) {                                                                                            \
+        cache->miss_count++;                                                                                   \
+        return NULL;                                                                                           \
+    }                                                                                                          \
+    if ((eviction) == CACHE_EVICT_LRU && cache->head != slot) {                                                \
+        name##_unlink(cache, slots, slot);                                                                     \
+        name##_link_front(cache, slots, slot);                                                                 \
+    }                                                                                                          \
+    cache->hit_count++;                                                                                        \
+    return &slots[slot].value;                                                                                 \
+}                                                                                                              \
+                                                                                                               \
+/* Insert or update a key. Returns 1 and stores the old value in *dropped if a value was replaced or */        \
+/* evicted, 0 otherwise. dropped may be NULL */                                                                \
+static inline int name##_put(name* cache, key_t key, value_t value, value_t* dropped) {                        \
+    name##_slot* slots = name##_slots(cache);                                                                  \
+    int* table = name##_table(cache);                                                                          \
+    unsigned long hash = hash_fn(key);                                                                         \
+    int position = name##_probe(cache, key, hash);                                                             \
+    int slot = table[position];                                                                                \
+                                                                                                               \
+    if (slot >= 0) {                                                                                           \
+        /* The key may point into the old value, so it is replaced too */                                      \
+        if (dropped) {                                                                                         \
+            *dropped = slots[slot].value;                                                                      \
+        }                                                                                                      \
+        slots[slot].key = key;                                                                                 \
+        slots[slot].value = value;                                                                             \
+        if ((eviction) == CACHE_EVICT_LRU && cache->head != slot) {                                            \
+            name##_unlink(cache, slots, slot);                                                                 \
+            name##_link_front(cache, slots, slot);                                                             \
+        }                                                                                                      \
+        return 1;                                                                                              \
+    }                                                                                                          \
+                                                                                                               \
+    int evicted = 0;                                                                                           \
+    if (cache->size < name##_capacity(cache)) {                                                                \
+        slot = cache->size++;                                                                                  \
+    } else {                                                                                                   \
+        if ((eviction) == CACHE_EVICT_LRU) {                                                                   \
+            slot = cache->tail;                                                                                \
+            name##_unlink(cache, slots, slot);                                                                 \
+        } else {                                                                                               \
+            /* xorshift64, cheaper than rand() and private to the cache */                                     \
+            cache->random_state ^= cache->random_state << 13;                                                  \
+            cache->random_state ^= cache->random_state >> 7;                                                   \
+            cache->random_state ^= cache->random_state << 17;                                                  \
+            slot = (int)(cache->random_state % (unsigned long long)name##_capacity(cache));                    \
+        }                                                                                                      \
+        if (dropped) {                                                                                         \
+            *dropped = slots[slot].value;                                                                      \
+        }                                                                                                      \
+        name##_remove_position(cache, name##_probe(cache, slots[slot].key, slots[slot].hash));                 \
+        position = name##_probe(cache, key, hash); /* The removal may have moved the empty position */         \
+        evicted = 1;                                                                                           \
+    }                                                                                                          \
+                                                                                                               \
+    slots[slot].key = key;                                                                                     \
+    slots[slot].value = value;                                                                                 \
+    slots[slot].hash = hash;                                                                                   \
+    table[position] = slot;                                                                                    \
+    if ((eviction) == CACHE_EVICT_LRU) {                                                                       \
+        name##_link_front(cache, slots, slot);                                                                 \
+    }                                                                                                          \
+    return evicted;                                                                                            \
+}
+
+#endif /* CACHETEMPLATE_H */
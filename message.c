@@ -1,12 +1,12 @@
 #include "message.h"
+#include "messageIndex.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
 
-#define MESSAGE_STORE_FILE "messageStore.txt"
-#define DELIMITER "|"
-
+// Index that store_msg() keeps in sync with the file, if any
+static MessageIndex* attached_index = NULL;
 
 // Helper function to get the current time as a string
 static char* get_current_time() {
@@ -27,6 +27,15 @@ void clear_message_store() {
         return;
     }
     fclose(file); // Closing the file will truncate it to zero length
+
+    if (attached_index) {
+        message_index_clear(attached_index); // Every offset in the index is now stale
+    }
+}
+
+// Keep an index up to date with every store_msg() and clear_message_store() call
+void attach_message_index(MessageIndex* index) {
+    attached_index = index;
 }
 
 // Create a new message
@@ -72,18 +81,27 @@ int store_msg(Message* msg) {
         return -1;
     }
 
-    int write_count = fprintf(file, "%s%s%s%s%s%s%s%s%s\n",
+    long offset = ftell(file); // Append mode, so this is the end of the file
+    int write_count = fprintf(file, "%s%s%s%s%s%s%s%s%s%s%d\n",
                               msg->id, DELIMITER,
                               msg->time_sent, DELIMITER,
                               msg->sender, DELIMITER,
                               msg->receiver, DELIMITER,
-                              msg->content);
+                              msg->content, DELIMITER,
+                              msg->delivered ? 1 : 0);
     if (write_count < 0) {
         perror("Error writing to file"); 
         fclose(file); // Always close the file if open.
         return -1;
     }
     fclose(file);
+
+    // The newline is not part of the record
+    if (attached_index && (offset < 0 || message_index_add_msg(attached_index, msg, offset, write_count - 1) != 0)) {
+        // The record is stored but the index missed it, a bulk load of the file would pick it up again
+        fprintf(stderr, "Error: Unable to index message %s.\n", msg->id);
+        return -1;
+    }
     return 0;
 }
 
@@ -102,31 +120,13 @@ Message* retrieve_msg(const char* id) {
     }
 
     char line[1024];
+    size_t id_length = strlen(id);
     //reads a limited number of characters from a given file stream source into an array of characters
-    while (fgets(line, sizeof(line), file)) { //
-        Message* msg = malloc(sizeof(Message));
-        if (!msg) {
-            fclose(file);
-            return NULL; // Memory allocation failed
-        }
-        // Use a temporary buffer to hold the token for ID comparison
-        char temp_id[ID_SIZE]; 
-        char* token = strtok(line, DELIMITER);
-        if (token && strcmp(token, id) == 0) {
-            Message* msg = malloc(sizeof(Message));
-            if (!msg) {
-                fclose(file);
-                return NULL; // Memory allocation failed
-            }
-
-            // Use strncpy to copy the ID into the message structure's ID field
-            strncpy(msg->id, token, sizeof(msg->id) - 1);
-            msg->id[sizeof(msg->id) - 1] = '\0';
-            msg->time_sent = strdup(strtok(NULL, DELIMITER));
-            msg->sender = strdup(strtok(NULL, DELIMITER));
-            msg->receiver = strdup(strtok(NULL, DELIMITER));
-            msg->content = strdup(strtok(NULL, DELIMITER));
-            msg->delivered = 0; 
+    while (fgets(line, sizeof(line), file)) {
+        // Only parse the record whose first field is the ID
+        if (strncmp(line, id, id_length) == 0 && line[id_length] == DELIMITER[0]) {
+            size_t length = strcspn(line, "\n");
+            Message* msg = parse_msg(line, length); // Same parser as the index, so '|' in the content is kept
 
             fclose(file);
             return msg;
@@ -143,7 +143,6 @@ void free_msg(Message* msg) {
         return;
     }
 
-    free(msg->id);
     free(msg->time_sent);
     free(msg->sender);
     free(msg->receiver);
@@ -151,4 +150,67 @@ void free_msg(Message* msg) {
     free(msg);
 }
 
+// Split one line of the store into its fields without modifying it, returns the number of fields found
+int split_msg_line(const char* line, size_t length, const char* fields[], size_t lengths[]) {
+    const char* end = line + length;
+    const char* start = line;
+    int count = 0;
+
+    while (count < MSG_FIELD_CONTENT) {
+        const char* stop = memchr(start, DELIMITER[0], end - start);
+        if (!stop) {
+            fields[count] = start;
+            lengths[count] = end - start;
+            return count + 1;
+        }
+        fields[count] = start;
+        lengths[count] = stop - start;
+        count++;
+        start = stop + 1;
+    }
+
+    // The content runs up to the delivered flag, so it keeps any delimiters it contains
+    const char* stop = end - 2;
+    fields[MSG_FIELD_CONTENT] = start;
+    if (end - start >= 2 && stop[0] == DELIMITER[0] && (stop[1] == '0' || stop[1] == '1')) {
+        lengths[MSG_FIELD_CONTENT] = stop - start;
+        fields[MSG_FIELD_DELIVERED] = stop + 1;
+        lengths[MSG_FIELD_DELIVERED] = 1;
+        return MSG_FIELD_COUNT;
+    }
+    lengths[MSG_FIELD_CONTENT] = end - start;
+    return MSG_FIELD_CONTENT + 1;
+}
 
+// Parse one line of the store into a newly allocated message, NULL if malformed
+Message* parse_msg(const char* line, size_t length) {
+    const char* fields[MSG_FIELD_COUNT];
+    size_t lengths[MSG_FIELD_COUNT];
+
+    int count = line ? split_msg_line(line, length, fields, lengths) : 0;
+    if (count < MSG_FIELD_CONTENT + 1) {
+        return NULL; // Missing fields
+    }
+
+    Message* msg = malloc(sizeof(Message));
+    if (!msg) {
+        return NULL; // Memory allocation failed
+    }
+
+    size_t id_length = lengths[MSG_FIELD_ID] < ID_SIZE - 1 ? lengths[MSG_FIELD_ID] : ID_SIZE - 1;
+    memcpy(msg->id, fields[MSG_FIELD_ID], id_length);
+    msg->id[id_length] = '\0';
+    msg->time_sent = strndup(fields[MSG_FIELD_TIME], lengths[MSG_FIELD_TIME]);
+    msg->sender = strndup(fields[MSG_FIELD_SENDER], lengths[MSG_FIELD_SENDER]);
+    msg->receiver = strndup(fields[MSG_FIELD_RECEIVER], lengths[MSG_FIELD_RECEIVER]);
+    msg->content = strndup(fields[MSG_FIELD_CONTENT], lengths[MSG_FIELD_CONTENT]);
+    msg->delivered = (count == MSG_FIELD_COUNT && fields[MSG_FIELD_DELIVERED][0] == '1');
+    msg->prev = NULL;
+    msg->next = NULL;
+
+    if (!msg->time_sent || !msg->sender || !msg->receiver || !msg->content) {
+        free_msg(msg);
+        return NULL; // Memory allocation failed
+    }
+    return msg;
+}
@@ -1,6 +1,8 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 #define ID_SIZE 20
+#define MESSAGE_STORE_FILE "messageStore.txt"
+#define DELIMITER "|"
 
 #include <stdlib.h>
 
@@ -16,6 +18,19 @@ typedef struct Message {
     struct Message* next; // Next message in LRU cache
 } Message;
 
+// Field positions within one line of the message store file
+enum {
+    MSG_FIELD_ID,
+    MSG_FIELD_TIME,
+    MSG_FIELD_SENDER,
+    MSG_FIELD_RECEIVER,
+    MSG_FIELD_CONTENT,
+    MSG_FIELD_DELIVERED, // Missing from records written before the flag was stored
+    MSG_FIELD_COUNT
+};
+
+struct MessageIndex;
+
 #include "LRUCache.h"
 #include "randomCache.h"
 
@@ -25,4 +40,14 @@ Message* retrieve_msg(const char* id);
 void free_msg(Message* msg);
 void clear_message_store();
 
+// Split one line of the store (without its newline) into its fields without modifying it. Returns the number
+// of fields found. Unlike strtok this keeps no hidden state, so it is safe to call from several threads.
+int split_msg_line(const char* line, size_t length, const char* fields[], size_t lengths[]);
+
+// Parse one line of the store (without its newline) into a newly allocated message, NULL if malformed
+Message* parse_msg(const char* line, size_t length);
+
+// Keep an index up to date with every store_msg() and clear_message_store() call, NULL to detach
+void attach_message_index(struct MessageIndex* index);
+
 #endif
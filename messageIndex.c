@@ -0,0 +1,429 @@
+#include "messageIndex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MIN_BUCKETS 16 // Smallest bucket table of a shard
+
+// Forward declaration of private helper functions
+static int rehash(IndexShard* shard, int bucket_count);
+static void bloom_set(IndexShard* shard, unsigned long hash);
+static int bloom_test(const IndexShard* shard, unsigned long hash);
+static char* read_record(FILE* file, long offset, int length, char** buffer, int* buffer_size);
+static int shard_make_room(IndexShard* shard);
+static void supersede(PostingsList* list, long offset);
+
+// Initialize an empty index
+void message_index_initialize(MessageIndex* index) {
+    memset(index->shards, 0, sizeof(index->shards));
+    postings_index_initialize(&index->by_receiver);
+    postings_index_initialize(&index->by_sender);
+    index->hit_count = 0;
+    index->miss_count = 0;
+}
+
+// Free all resources used by the index
+void message_index_free(MessageIndex* index) {
+    for (int i = 0; i < INDEX_SHARDS; ++i) {
+        free(index->shards[i].entries);
+        free(index->shards[i].buckets);
+        free(index->shards[i].bloom);
+    }
+    postings_index_free(&index->by_receiver);
+    postings_index_free(&index->by_sender);
+    message_index_initialize(index);
+}
+
+// Remove every entry but keep the allocated memory
+void message_index_clear(MessageIndex* index) {
+    for (int i = 0; i < INDEX_SHARDS; ++i) {
+        IndexShard* shard = &index->shards[i];
+        shard->count = 0;
+        if (shard->buckets) {
+            memset(shard->buckets, -1, shard->bucket_count * sizeof(int));
+            memset(shard->bloom, 0, shard->bucket_count);
+        }
+    }
+    postings_index_clear(&index->by_receiver);
+    postings_index_clear(&index->by_sender);
+}
+
+// Add a record to the index, a record with the same ID replaces the older one
+int message_index_add(MessageIndex* index, const char* id, long offset, int length) {
+    IndexEntry entry;
+    size_t id_length = strlen(id);
+    if (id_length >= ID_SIZE) {
+        return -1; // Would not fit in the entry
+    }
+    memcpy(entry.id, id, id_length + 1);
+    entry.offset = offset;
+    entry.length = length;
+    entry.sender_list = NULL;
+    entry.receiver_list = NULL;
+
+    unsigned long hash = message_index_hash(id, id_length);
+    return index_shard_add(&index->shards[hash & (INDEX_SHARDS - 1)], hash, &entry) < 0 ? -1 : 0;
+}
+
+// Add a stored message to the ID index and to both postings indexes
+int message_index_add_msg(MessageIndex* index, const Message* msg, long offset, int length) {
+    Posting posting = { offset, length, msg->delivered ? 1 : 0, 0 };
+    IndexEntry entry;
+    size_t id_length = strlen(msg->id);
+    if (id_length >= ID_SIZE) {
+        return -1; // Would not fit in the entry
+    }
+
+    // Make room everywhere first, so a failure leaves no posting without an entry
+    unsigned long hash = message_index_hash(msg->id, id_length);
+    IndexShard* shard = &index->shards[hash & (INDEX_SHARDS - 1)];
+    entry.receiver_list = postings_index_reserve(&index->by_receiver, msg->receiver, strlen(msg->receiver));
+    entry.sender_list = postings_index_reserve(&index->by_sender, msg->sender, strlen(msg->sender));
+    if (!entry.receiver_list || !entry.sender_list ||
+        (!index_shard_find(shard, hash, msg->id) && shard_make_room(shard) != 0)) {
+        return -1;
+    }
+
+    memcpy(entry.id, msg->id, id_length + 1);
+    entry.offset = offset;
+    entry.length = length;
+    postings_list_append(entry.receiver_list, &posting);
+    postings_list_append(entry.sender_list, &posting);
+
+    // Adding the entry supersedes the postings of an older record with the same ID, and cannot fail now
+    return index_shard_add(shard, hash, &entry) < 0 ? -1 : 0;
+}
+
+// Find the record of a message, returns NULL if the ID is not indexed
+const IndexEntry* message_index_lookup(MessageIndex* index, const char* id) {
+    unsigned long hash = message_index_hash(id, strlen(id));
+    const IndexEntry* entry = index_shard_find(&index->shards[hash & (INDEX_SHARDS - 1)], hash, id);
+
+    if (entry) {
+        index->hit_count++;
+    } else {
+        index->miss_count++;
+    }
+    return entry;
+}
+
+// Read a message from the store file through the index, returns NULL if not found
+Message* message_index_retrieve(MessageIndex* index, const char* path, const char* id) {
+    if (!id) {
+        fprintf(stderr, "Error: Message ID is NULL.\n");
+        return NULL;
+    }
+
+    const IndexEntry* entry = message_index_lookup(index, id);
+    if (!entry) {
+        return NULL; // Message not found
+    }
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Unable to open file for reading.\n");
+        return NULL;
+    }
+
+    char* buffer = NULL;
+    int buffer_size = 0;
+    char* line = read_record(file, entry->offset, entry->length, &buffer, &buffer_size);
+    Message* msg = line ? parse_msg(line, entry->length) : NULL;
+    free(buffer);
+    fclose(file);
+
+    // A stale index could point into a different record
+    if (msg && strcmp(msg->id, id) != 0) {
+        free_msg(msg);
+        return NULL;
+    }
+    return msg;
+}
+
+// Mark a stored message as delivered, in the store file and in the postings
+int message_index_mark_delivered(MessageIndex* index, const char* path, const char* id) {
+    const IndexEntry* entry = message_index_lookup(index, id);
+    if (!entry) {
+        return -1; // Message not found
+    }
+
+    FILE* file = fopen(path, "r+");
+    if (!file) {
+        perror("Error: Unable to open file for writing");
+        return -1;
+    }
+
+    char* buffer = NULL;
+    int buffer_size = 0;
+    char* line = read_record(file, entry->offset, entry->length, &buffer, &buffer_size);
+    const char* fields[MSG_FIELD_COUNT];
+    size_t lengths[MSG_FIELD_COUNT];
+    if (!line || split_msg_line(line, entry->length, fields, lengths) != MSG_FIELD_COUNT) {
+        fprintf(stderr, "Error: Record of %s has no delivered flag.\n", id);
+        free(buffer);
+        fclose(file);
+        return -1;
+    }
+
+    // The flag is the last byte of the record, so it is overwritten in place
+    int result = 0;
+    if (fseek(file, entry->offset + entry->length - 1, SEEK_SET) != 0 || fputc('1', file) == EOF) {
+        perror("Error writing to file");
+        result = -1;
+    }
+    fclose(file);
+
+    if (result == 0) {
+        Posting* posting;
+        if (entry->sender_list && (posting = postings_list_find(entry->sender_list, entry->offset))) {
+            posting->delivered = 1;
+        }
+        if (entry->receiver_list && (posting = postings_list_find(entry->receiver_list, entry->offset))) {
+            posting->delivered = 1;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+// Number of records in the index
+int message_index_size(const MessageIndex* index) {
+    int size = 0;
+    for (int i = 0; i < INDEX_SHARDS; ++i) {
+        size += index->shards[i].count;
+    }
+    return size;
+}
+
+// hash function to map an ID to a shard, a bucket and its bloom filter bits
+unsigned long message_index_hash(const char* id, size_t length) {
+    unsigned long hash = 5381;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash = ((hash << 5) + hash) + (unsigned char)id[i]; // hash * 33 + c
+    }
+
+    // djb2 leaves the low bits poorly mixed for IDs that differ only in the last digit
+    hash ^= hash >> 15;
+    hash *= 2654435761UL;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// Prepare a shard for at least the given number of entries
+int index_shard_reserve(IndexShard* shard, int count) {
+    if (count > shard->capacity) {
+        IndexEntry* entries = realloc(shard->entries, count * sizeof(IndexEntry));
+        if (!entries) {
+            return -1; // Memory allocation failed
+        }
+        shard->entries = entries;
+        shard->capacity = count;
+    }
+
+    int bucket_count = shard->bucket_count ? shard->bucket_count : MIN_BUCKETS;
+    while (bucket_count < count) {
+        bucket_count *= 2;
+    }
+    if (bucket_count != shard->bucket_count) {
+        return rehash(shard, bucket_count);
+    }
+    return 0;
+}
+
+// Find the entry of an ID in one shard without counting a hit or a miss
+IndexEntry* index_shard_find(const IndexShard* shard, unsigned long hash, const char* id) {
+    if (shard->count == 0 || !bloom_test(shard, hash)) {
+        return NULL;
+    }
+
+    int position = shard->buckets[(hash >> 6) & (shard->bucket_count - 1)];
+    while (position >= 0) {
+        IndexEntry* entry = &shard->entries[position];
+        if (strcmp(entry->id, id) == 0) {
+            return entry;
+        }
+        position = entry->next;
+    }
+    return NULL;
+}
+
+// Add an entry to one shard, the hash must be message_index_hash() of the ID
+int index_shard_add(IndexShard* shard, unsigned long hash, const IndexEntry* entry) {
+    // Replace the record of an ID that is already indexed, queries must no longer see the old one
+    IndexEntry* existing = index_shard_find(shard, hash, entry->id);
+    if (existing) {
+        if (existing->offset != entry->offset) {
+            supersede(existing->sender_list, existing->offset);
+            supersede(existing->receiver_list, existing->offset);
+        }
+        existing->offset = entry->offset;
+        existing->length = entry->length;
+        existing->sender_list = entry->sender_list;
+        existing->receiver_list = entry->receiver_list;
+        return 1;
+    }
+
+    if (shard_make_room(shard) != 0) {
+        return -1;
+    }
+
+    int bucket = (hash >> 6) & (shard->bucket_count - 1);
+    IndexEntry* added = &shard->entries[shard->count];
+    *added = *entry;
+    added->next = shard->buckets[bucket];
+    shard->buckets[bucket] = shard->count++;
+    bloom_set(shard, hash);
+    return 0;
+}
+
+// Open a cursor over the messages of one receiver or sender
+int message_cursor_open(MessageCursor* cursor, MessageIndex* index, const char* path, IndexField field,
+                        const char* key, int undelivered_only) {
+    memset(cursor, 0, sizeof(MessageCursor));
+    if (!key) {
+        fprintf(stderr, "Error: Cursor key is NULL.\n");
+        return -1;
+    }
+
+    cursor->list = postings_index_find(field == BY_SENDER ? &index->by_sender : &index->by_receiver, key);
+    cursor->position = cursor->list ? cursor->list->count : 0;
+    cursor->undelivered_only = undelivered_only;
+    if (cursor->position == 0) {
+        return 0; // Nothing to read, no need for the file
+    }
+
+    cursor->file = fopen(path, "r");
+    if (!cursor->file) {
+        fprintf(stderr, "Error: Unable to open file for reading.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Fill a page with the next messages, newest first
+int message_cursor_next_page(MessageCursor* cursor, Message* page[], int page_size) {
+    int filled = 0;
+    if (!cursor->list) {
+        return 0;
+    }
+
+    // The index may have been cleared since the cursor was opened
+    if (cursor->position > cursor->list->count) {
+        cursor->position = cursor->list->count;
+    }
+
+    while (filled < page_size && cursor->position > 0) {
+        const Posting* posting = &cursor->list->postings[--cursor->position];
+        if (posting->superseded || (cursor->undelivered_only && posting->delivered)) {
+            continue; // Filtered without reading the record
+        }
+
+        char* line = read_record(cursor->file, posting->offset, posting->length, &cursor->buffer,
+                                 &cursor->buffer_size);
+        Message* msg = line ? parse_msg(line, posting->length) : NULL;
+        if (!msg) {
+            while (filled > 0) {
+                free_msg(page[--filled]);
+            }
+            return -1;
+        }
+        msg->delivered = posting->delivered; // Updated together with the file, so never behind it
+        page[filled++] = msg;
+    }
+    return filled;
+}
+
+// Free all resources used by a cursor
+void message_cursor_close(MessageCursor* cursor) {
+    if (cursor->file) {
+        fclose(cursor->file);
+    }
+    free(cursor->buffer);
+    memset(cursor, 0, sizeof(MessageCursor));
+}
+
+// Read one record into a buffer that grows as needed, returns NULL on error. The read bypasses the stdio
+// buffer of the stream, which could still hold bytes of a record marked delivered since it was filled
+static char* read_record(FILE* file, long offset, int length, char** buffer, int* buffer_size) {
+    if (length < 0) {
+        return NULL; // Corrupt entry
+    }
+    if (length > *buffer_size) {
+        char* grown = realloc(*buffer, length);
+        if (!grown) {
+            return NULL; // Memory allocation failed
+        }
+        *buffer = grown;
+        *buffer_size = length;
+    }
+
+    if (pread(fileno(file), *buffer, length, offset) != length) {
+        return NULL;
+    }
+    return *buffer;
+}
+
+// Make sure one more entry fits in a shard
+static int shard_make_room(IndexShard* shard) {
+    // Grow geometrically so appending one message at a time stays amortized O(1)
+    if (shard->count == shard->capacity || !shard->buckets) {
+        int capacity = shard->capacity ? shard->capacity * 2 : MIN_BUCKETS;
+        return index_shard_reserve(shard, capacity);
+    }
+    return 0;
+}
+
+// Flag the posting of a replaced record so queries skip it
+static void supersede(PostingsList* list, long offset) {
+    Posting* posting = list ? postings_list_find(list, offset) : NULL;
+    if (posting) {
+        posting->superseded = 1;
+    }
+}
+
+// Rebuild the buckets and the bloom filter of a shard with a new number of buckets
+static int rehash(IndexShard* shard, int bucket_count) {
+    int* buckets = malloc(bucket_count * sizeof(int));
+    unsigned char* bloom = calloc(bucket_count, 1);
+    if (!buckets || !bloom) {
+        free(buckets);
+        free(bloom);
+        return -1; // Memory allocation failed
+    }
+    memset(buckets, -1, bucket_count * sizeof(int));
+
+    free(shard->buckets);
+    free(shard->bloom);
+    shard->buckets = buckets;
+    shard->bloom = bloom;
+    shard->bucket_count = bucket_count;
+
+    for (int i = 0; i < shard->count; ++i) {
+        IndexEntry* entry = &shard->entries[i];
+        unsigned long hash = message_index_hash(entry->id, strlen(entry->id));
+        int bucket = (hash >> 6) & (bucket_count - 1);
+        entry->next = buckets[bucket];
+        buckets[bucket] = i;
+        bloom_set(shard, hash);
+    }
+    return 0;
+}
+
+// Set the two bloom filter bits of a hash, the filter holds 8 bits per bucket
+static void bloom_set(IndexShard* shard, unsigned long hash) {
+    unsigned long mask = (unsigned long)shard->bucket_count * 8 - 1;
+    unsigned long first = (hash >> 6) & mask;
+    unsigned long second = (hash * 0x9E3779B1UL >> 7) & mask;
+    shard->bloom[first >> 3] |= 1 << (first & 7);
+    shard->bloom[second >> 3] |= 1 << (second & 7);
+}
+
+// Test the two bloom filter bits of a hash, 0 means the ID is definitely not in the shard
+static int bloom_test(const IndexShard* shard, unsigned long hash) {
+    unsigned long mask = (unsigned long)shard->bucket_count * 8 - 1;
+    unsigned long first = (hash >> 6) & mask;
+    unsigned long second = (hash * 0x9E3779B1UL >> 7) & mask;
+    return (shard->bloom[first >> 3] >> (first & 7)) & (shard->bloom[second >> 3] >> (second & 7)) & 1;
+}
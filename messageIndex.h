@@ -0,0 +1,122 @@
+#ifndef MESSAGEINDEX_H
+#define MESSAGEINDEX_H
+
+#include "message.h"
+#include "postingsIndex.h"
+#include <stdio.h>
+
+#define INDEX_SHARDS 64 // Number of independent hash tables in an index, must be a power of 2
+
+// The index maps a message ID to the position of its record in the store file, so a message can be read with
+// one seek instead of scanning the whole file as retrieve_msg() does. It is split into shards chosen by the
+// hash of the ID. Each shard is a chained hash table whose entries live in one growable array and are linked by
+// array position instead of by pointer, so growing the array never invalidates a chain. Sharding lets the bulk
+// loader build all shards at the same time, one thread per group of shards, without any locking.
+
+// Each shard also carries a small bloom filter over its IDs. A lookup for an ID that was never stored is
+// usually answered by two bit tests, without walking a chain or comparing strings.
+
+// Next to the ID shards the index keeps two postings indexes, by receiver and by sender, so the messages of
+// one user can be listed newest first without reading the rest of the file. Each entry points at the two lists
+// holding its record, so when an ID is stored again the postings of the older record are found and flagged as
+// superseded without reading the file.
+
+typedef struct {
+    char id[ID_SIZE]; // Message ID, the key.
+    long offset;      // Byte offset of the record in the store file.
+    int length;       // Length of the record, without the newline.
+    int next;         // Position of the next entry in the same bucket, -1 ends the chain.
+    PostingsList* sender_list;   // List of the sender holding the record, NULL if not added yet.
+    PostingsList* receiver_list; // List of the receiver holding the record, NULL if not added yet.
+} IndexEntry;
+
+typedef struct {
+    IndexEntry* entries;   // Every entry of the shard, in the order they were added.
+    int count;             // Number of entries in use.
+    int capacity;          // Number of entries allocated.
+    int* buckets;          // Position of the first entry of each bucket, -1 if empty.
+    int bucket_count;      // Number of buckets, always a power of 2.
+    unsigned char* bloom;  // Bloom filter bits, one byte per bucket.
+} IndexShard;
+
+typedef struct MessageIndex {
+    IndexShard shards[INDEX_SHARDS];
+    PostingsIndex by_receiver; // Records of each receiver in store order.
+    PostingsIndex by_sender;   // Records of each sender in store order.
+    unsigned long hit_count;
+    unsigned long miss_count;
+} MessageIndex;
+
+// Initialize an empty index
+void message_index_initialize(MessageIndex* index);
+
+// Free all resources used by the index
+void message_index_free(MessageIndex* index);
+
+// Remove every entry but keep the allocated memory
+void message_index_clear(MessageIndex* index);
+
+// Add a record to the index, a record with the same ID replaces the older one. Returns 0 on success, -1 otherwise
+int message_index_add(MessageIndex* index, const char* id, long offset, int length);
+
+// Add a stored message to the ID index and to both postings indexes. Returns 0 on success, -1 otherwise
+int message_index_add_msg(MessageIndex* index, const Message* msg, long offset, int length);
+
+// Find the record of a message, returns NULL if the ID is not indexed
+const IndexEntry* message_index_lookup(MessageIndex* index, const char* id);
+
+// Read a message from the store file through the index, returns NULL if not found
+Message* message_index_retrieve(MessageIndex* index, const char* path, const char* id);
+
+// Mark a stored message as delivered, in the store file and in the postings. Returns 0 on success, -1 otherwise
+int message_index_mark_delivered(MessageIndex* index, const char* path, const char* id);
+
+// Number of records in the index
+int message_index_size(const MessageIndex* index);
+
+// Hash used to pick the shard and bucket of an ID, exposed so the bulk loader can partition by shard
+unsigned long message_index_hash(const char* id, size_t length);
+
+// Prepare a shard for at least the given number of entries
+int index_shard_reserve(IndexShard* shard, int count);
+
+// Find the entry of an ID in one shard without counting a hit or a miss, NULL if not indexed
+IndexEntry* index_shard_find(const IndexShard* shard, unsigned long hash, const char* id);
+
+// Add an entry to one shard, the hash must be message_index_hash() of the ID. An entry with the same ID is
+// replaced and the postings of its record are flagged as superseded. Returns 1 if an entry was replaced,
+// 0 if one was added, -1 on error
+int index_shard_add(IndexShard* shard, unsigned long hash, const IndexEntry* entry);
+
+// Which postings index a cursor walks
+typedef enum {
+    BY_RECEIVER,
+    BY_SENDER
+} IndexField;
+
+// A cursor yields the messages of one receiver or sender newest first, a page at a time. Only the records of
+// the page being returned are read and parsed, so a caller that stops early never pays for the rest. Messages
+// stored after the cursor was opened are newer than anything it has left to yield, so they are not returned.
+// The delivered flag of a returned message comes from its posting, so a message delivered while the cursor is
+// open is returned as delivered.
+typedef struct {
+    const PostingsList* list; // List being walked, NULL if no record matches.
+    int position;             // Postings left to visit, the next one is at position - 1.
+    int undelivered_only;     // Skip messages whose delivered flag is set.
+    FILE* file;               // Store file the records are read from, unbuffered with pread().
+    char* buffer;             // Holds one record while it is parsed.
+    int buffer_size;
+} MessageCursor;
+
+// Open a cursor over the messages of one receiver or sender. Returns 0 on success, -1 otherwise
+int message_cursor_open(MessageCursor* cursor, MessageIndex* index, const char* path, IndexField field,
+                        const char* key, int undelivered_only);
+
+// Fill a page with the next messages, newest first. Returns how many were read, 0 at the end, -1 on error.
+// The caller owns the returned messages.
+int message_cursor_next_page(MessageCursor* cursor, Message* page[], int page_size);
+
+// Free all resources used by a cursor
+void message_cursor_close(MessageCursor* cursor);
+
+#endif /* MESSAGEINDEX_H */
@@ -2,6 +2,9 @@
 #include "LRUCache.h"
 #include "randomCache.h"
 #include "genRand.h"
+#include "messageIndex.h"
+#include "bulkLoad.h"
+#include "cacheTemplate.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +17,21 @@
 //the max length of an id
 #define MAX_ID_LENGTH 10
 
+// Caches generated at compile time: full messages by ID, and store offsets by the number of a message ID
+DEFINE_CACHE(MessageLRUCache, const char*, Message*, cache_hash_string, cache_equal_string, MAX_CACHE_SIZE,
+             CACHE_EVICT_LRU)
+DEFINE_CACHE(MessageRandomCache, const char*, Message*, cache_hash_string, cache_equal_string, MAX_CACHE_SIZE,
+             CACHE_EVICT_RANDOM)
+DEFINE_CACHE(OffsetCache, unsigned long, long, cache_hash_ulong, cache_equal_ulong, CACHE_RUNTIME_CAPACITY,
+             CACHE_EVICT_LRU)
+
+// Keys that are multiples of 8 all land on the same position of a capacity 4 table, to test long probe runs
+static inline unsigned long identity_hash(unsigned long key) {
+    return key;
+}
+DEFINE_CACHE(SmallLRUCache, unsigned long, long, identity_hash, cache_equal_ulong, 4, CACHE_EVICT_LRU)
+DEFINE_CACHE(SmallRandomCache, unsigned long, long, identity_hash, cache_equal_ulong, 4, CACHE_EVICT_RANDOM)
+
 //helper function to generate random word with provided length
 char* generate_random_word(int length) {
     char* word = (char*) malloc(length + 1); // +1 for the null terminator
@@ -204,12 +222,394 @@ void test_cache_performance() {
 
 }
 
+// Test function for the compile-time generated caches
+void test_template_caches() {
+    printf("Testing Template Caches...\n");
+
+    MessageLRUCache lru_cache;
+    MessageLRUCache_initialize(&lru_cache, 0);
+    MessageRandomCache random_cache;
+    MessageRandomCache_initialize(&random_cache, 0);
+
+    // Same workload as test_cache_performance
+    Message messages[TOTAL_MESSAGES];
+    generate_messages(messages);
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        MessageLRUCache_put(&lru_cache, messages[i].id, &messages[i], NULL);
+        MessageRandomCache_put(&random_cache, messages[i].id, &messages[i], NULL);
+    }
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        int msgIndex = genRand(0, TOTAL_MESSAGES - 1);
+        Message** lru_hit = MessageLRUCache_get(&lru_cache, messages[msgIndex].id);
+        Message** random_hit = MessageRandomCache_get(&random_cache, messages[msgIndex].id);
+        if ((lru_hit && *lru_hit != &messages[msgIndex]) || (random_hit && *random_hit != &messages[msgIndex])) {
+            printf("Template cache returned the wrong message for %s - ERROR!\n", messages[msgIndex].id);
+        }
+    }
+    printf("Template LRU Cache Hit Ratio: %f\n", (float)lru_cache.hit_count / TOTAL_MESSAGES);
+    printf("Template Random Cache Hit Ratio: %f\n", (float)random_cache.hit_count / TOTAL_MESSAGES);
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        free(messages[i].content);
+    }
+
+    // Fill a small LRU cache with colliding keys, touch the oldest, and the second oldest must be evicted
+    int eviction_errors = 0;
+    SmallLRUCache small_lru;
+    SmallLRUCache_initialize(&small_lru, 0);
+    for (unsigned long key = 0; key < 32; key += 8) {
+        SmallLRUCache_put(&small_lru, key, key + 1, NULL);
+    }
+    long dropped = -1;
+    SmallLRUCache_get(&small_lru, 0);
+    if (SmallLRUCache_put(&small_lru, 32, 33, &dropped) != 1 || dropped != 9 || SmallLRUCache_size(&small_lru) != 4) {
+        eviction_errors++;
+    }
+    // Removing key 8 shifted 16 and 24 back in the probe run, so every survivor must still be found
+    if (SmallLRUCache_get(&small_lru, 8)) {
+        eviction_errors++;
+    }
+    for (unsigned long key = 0; key <= 32; key += 8) {
+        long* value = SmallLRUCache_get(&small_lru, key);
+        if (key != 8 && (!value || *value != (long)key + 1)) {
+            eviction_errors++;
+        }
+    }
+    // Key 0 is now the least recently used, and replacing a value hands back the old one
+    if (SmallLRUCache_put(&small_lru, 40, 41, &dropped) != 1 || dropped != 1 || SmallLRUCache_get(&small_lru, 0) ||
+        SmallLRUCache_put(&small_lru, 16, 100, &dropped) != 1 || dropped != 17) {
+        eviction_errors++;
+    }
+
+    // Random eviction must keep the cache full and every key it holds reachable
+    SmallRandomCache small_random;
+    SmallRandomCache_initialize(&small_random, 0);
+    for (unsigned long key = 0; key < 8 * 100; key += 8) {
+        SmallRandomCache_put(&small_random, key, key + 1, NULL);
+        int found = 0;
+        for (unsigned long seen = 0; seen <= key; seen += 8) {
+            long* value = SmallRandomCache_get(&small_random, seen);
+            if (value) {
+                found++;
+                eviction_errors += *value != (long)seen + 1;
+            }
+        }
+        int expected = key / 8 < 4 ? (int)(key / 8) + 1 : 4;
+        if (SmallRandomCache_size(&small_random) != expected || found != expected ||
+            !SmallRandomCache_get(&small_random, key)) {
+            eviction_errors++;
+        }
+    }
+    printf("Template cache eviction check: %s\n", eviction_errors ? "FAILED" : "OK");
+
+    // Cache store offsets by the number of the message ID, in front of an index
+    MessageIndex index;
+    message_index_initialize(&index);
+    attach_message_index(&index);
+    clear_message_store();
+    unsigned long numbers[TOTAL_MESSAGES];
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        Message* msg = create_msg("OffsetSender", "OffsetReceiver", "offset cache");
+        store_msg(msg);
+        numbers[i] = strtoul(msg->id + strlen("MSG-"), NULL, 10);
+        free_msg(msg);
+    }
+    attach_message_index(NULL);
+
+    OffsetCache offset_cache;
+    OffsetCache_initialize(&offset_cache, TOTAL_MESSAGES / 10);
+    int errors = 0;
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        unsigned long number = numbers[genRand(0, TOTAL_MESSAGES / 5 - 1)]; // A hot set twice the cache size
+        char id[ID_SIZE];
+        snprintf(id, ID_SIZE, "MSG-%06lu", number);
+        const IndexEntry* entry = message_index_lookup(&index, id);
+        long* offset = OffsetCache_get(&offset_cache, number);
+        if (!offset && entry) {
+            OffsetCache_put(&offset_cache, number, entry->offset, NULL);
+        } else if (!entry || *offset != entry->offset) {
+            errors++;
+        }
+    }
+    printf("Offset Cache Hit Ratio: %f, check: %s\n", (float)offset_cache.hit_count / TOTAL_MESSAGES,
+           errors ? "FAILED" : "OK");
+
+    OffsetCache_free(&offset_cache);
+    MessageRandomCache_free(&random_cache);
+    MessageLRUCache_free(&lru_cache);
+    message_index_free(&index);
+    clear_message_store();
+}
+
+// Test function for bootstrapping an index from an existing store file
+void test_bulk_load() {
+    printf("Testing Bulk Load...\n");
+
+    // Write a store file while an index follows every store_msg() call
+    MessageIndex live_index;
+    message_index_initialize(&live_index);
+    attach_message_index(&live_index);
+    clear_message_store();
+    char stored_ids[TOTAL_MESSAGES][ID_SIZE];
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        char* content = generate_random_word(MESSAGE_LENGTH);
+        Message* msg = create_msg("BulkSender", "BulkReceiver", content);
+        store_msg(msg);
+        strcpy(stored_ids[i], msg->id);
+        free(content);
+        free_msg(msg);
+    }
+    attach_message_index(NULL);
+
+    // Load the same file from scratch, as a fresh node would. The file is small, so ask for several threads
+    // explicitly to split it into chunks and merge across them.
+    MessageIndex index;
+    message_index_initialize(&index);
+    LRUCache warm_cache;
+    LRUCache_initialize(&warm_cache);
+    int loaded = bulk_load_store(MESSAGE_STORE_FILE, &index, &warm_cache, 4);
+    printf("Bulk loaded %d messages, index holds %d, live index holds %d\n",
+           loaded, message_index_size(&index), message_index_size(&live_index));
+    printf("Warm cache holds %d messages\n", warm_cache.current_size);
+
+    // Every record of the bulk index should match the live index
+    int mismatches = (loaded != TOTAL_MESSAGES || message_index_size(&index) != TOTAL_MESSAGES);
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        const IndexEntry* live = message_index_lookup(&live_index, stored_ids[i]);
+        const IndexEntry* bulk = message_index_lookup(&index, stored_ids[i]);
+        if (!live || !bulk || live->offset != bulk->offset || live->length != bulk->length) {
+            printf("Index mismatch for %s - ERROR!\n", stored_ids[i]);
+            mismatches++;
+        }
+    }
+
+    // A sample read through the bulk index should match the disk scan of retrieve_msg()
+    for (int i = 0; i < TOTAL_MESSAGES; i += TOTAL_MESSAGES / 10) {
+        Message* indexed = message_index_retrieve(&index, MESSAGE_STORE_FILE, stored_ids[i]);
+        Message* scanned = retrieve_msg(stored_ids[i]);
+        if (!indexed || !scanned || strcmp(indexed->id, scanned->id) != 0 ||
+            strcmp(indexed->content, scanned->content) != 0 || strcmp(indexed->sender, scanned->sender) != 0) {
+            printf("Disk scan mismatch for %s - ERROR!\n", stored_ids[i]);
+            mismatches++;
+        }
+        free_msg(indexed);
+        free_msg(scanned);
+    }
+    if (message_index_lookup(&index, "MSG-NOT-STORED")) {
+        printf("Found a message that was never stored - ERROR!\n");
+        mismatches++;
+    }
+    printf("Bulk load index check: %s\n", mismatches ? "FAILED" : "OK");
+
+    LRUCache_free(&warm_cache);
+    message_index_free(&index);
+    message_index_free(&live_index);
+    clear_message_store();
+}
+
+// Test function for listing messages by receiver and sender
+void test_secondary_index() {
+    printf("Testing Secondary Indexes...\n");
+
+    MessageIndex index;
+    message_index_initialize(&index);
+    attach_message_index(&index);
+    clear_message_store();
+
+    // Alice receives every third message, Bob the rest
+    char alice_ids[TOTAL_MESSAGES][ID_SIZE];
+    int alice_count = 0;
+    for (int i = 0; i < TOTAL_MESSAGES; ++i) {
+        char* content = generate_random_word(MESSAGE_LENGTH);
+        Message* msg = create_msg(i % 2 ? "Carol" : "Dave", i % 3 ? "Bob" : "Alice", content);
+        store_msg(msg);
+        if (i % 3 == 0) {
+            strcpy(alice_ids[alice_count++], msg->id);
+        }
+        free(content);
+        free_msg(msg);
+    }
+    attach_message_index(NULL);
+
+    // Deliver every other message of Alice
+    int delivered = 0;
+    for (int i = 0; i < alice_count; i += 2) {
+        if (message_index_mark_delivered(&index, MESSAGE_STORE_FILE, alice_ids[i]) == 0) {
+            delivered++;
+        }
+    }
+
+    // Page through the undelivered messages of Alice, they should come newest first
+    MessageCursor cursor;
+    Message* page[MAX_CACHE_SIZE];
+    int seen = 0;
+    int errors = 0;
+    int expected = (alice_count - 1) % 2 ? alice_count - 1 : alice_count - 2; // Newest message left undelivered
+    message_cursor_open(&cursor, &index, MESSAGE_STORE_FILE, BY_RECEIVER, "Alice", 1);
+    int count;
+    while ((count = message_cursor_next_page(&cursor, page, MAX_CACHE_SIZE)) > 0) {
+        for (int i = 0; i < count; ++i) {
+            if (expected < 0 || strcmp(page[i]->id, alice_ids[expected]) != 0 || page[i]->delivered) {
+                errors++;
+            }
+            expected -= 2;
+            seen++;
+            free_msg(page[i]);
+        }
+    }
+    message_cursor_close(&cursor);
+    printf("Delivered %d of %d messages for Alice, cursor returned %d undelivered\n", delivered, alice_count, seen);
+
+    // A message delivered while a cursor is open must show up delivered on the next page
+    char r_ids[20][ID_SIZE];
+    attach_message_index(&index);
+    for (int i = 0; i < 20; ++i) {
+        Message* msg = create_msg("S", "R", "paged");
+        store_msg(msg);
+        strcpy(r_ids[i], msg->id);
+        free_msg(msg);
+    }
+    attach_message_index(NULL);
+    Message* r_page[8];
+    message_cursor_open(&cursor, &index, MESSAGE_STORE_FILE, BY_RECEIVER, "R", 0);
+    count = message_cursor_next_page(&cursor, r_page, 8); // Messages 19 down to 12
+    for (int i = 0; i < count; ++i) {
+        free_msg(r_page[i]);
+    }
+    message_index_mark_delivered(&index, MESSAGE_STORE_FILE, r_ids[10]);
+    count = message_cursor_next_page(&cursor, r_page, 8); // Messages 11 down to 4
+    if (count != 8 || strcmp(r_page[1]->id, r_ids[10]) != 0 || !r_page[1]->delivered || r_page[0]->delivered) {
+        errors++;
+    }
+    for (int i = 0; i < count; ++i) {
+        free_msg(r_page[i]);
+    }
+    message_cursor_close(&cursor);
+
+    // A delimiter in the content must not be taken for the delivered flag, by either way of reading a record
+    Message* piped = create_msg("S", "R", "tail|1");
+    attach_message_index(&index);
+    store_msg(piped);
+    attach_message_index(NULL);
+    Message* scanned = retrieve_msg(piped->id);
+    Message* indexed = message_index_retrieve(&index, MESSAGE_STORE_FILE, piped->id);
+    if (!scanned || !indexed || strcmp(scanned->content, "tail|1") != 0 || scanned->delivered ||
+        strcmp(indexed->content, scanned->content) != 0 || indexed->delivered != scanned->delivered) {
+        errors++;
+    }
+    free_msg(scanned);
+    free_msg(indexed);
+    free_msg(piped);
+
+    // A fresh node loading the file should see the same lists and flags
+    MessageIndex loaded;
+    message_index_initialize(&loaded);
+    bulk_load_store(MESSAGE_STORE_FILE, &loaded, NULL, 4);
+    const char* keys[] = { "Alice", "Bob" };
+    for (int k = 0; k < 2; ++k) {
+        PostingsList* live = postings_index_find(&index.by_receiver, keys[k]);
+        PostingsList* bulk = postings_index_find(&loaded.by_receiver, keys[k]);
+        if (!live || !bulk || live->count != bulk->count) {
+            errors++;
+            continue;
+        }
+        for (int i = 0; i < live->count; ++i) {
+            const Posting* a = &live->postings[i];
+            const Posting* b = &bulk->postings[i];
+            if (a->offset != b->offset || a->length != b->length || a->delivered != b->delivered ||
+                a->superseded != b->superseded) {
+                errors++;
+            }
+        }
+    }
+    PostingsList* carol = postings_index_find(&loaded.by_sender, "Carol");
+    if (!carol || carol->count != TOTAL_MESSAGES / 2 || seen != alice_count - delivered) {
+        errors++;
+    }
+    printf("Secondary index check: %s\n", errors ? "FAILED" : "OK");
+
+    message_index_free(&loaded);
+    message_index_free(&index);
+    clear_message_store();
+}
+
+// helper function to count the messages a cursor returns
+int count_cursor_messages(MessageIndex* index, IndexField field, const char* key, int undelivered_only) {
+    MessageCursor cursor;
+    Message* page[MAX_CACHE_SIZE];
+    int total = 0;
+    int count;
+
+    if (message_cursor_open(&cursor, index, MESSAGE_STORE_FILE, field, key, undelivered_only) != 0) {
+        return -1;
+    }
+    while ((count = message_cursor_next_page(&cursor, page, MAX_CACHE_SIZE)) > 0) {
+        for (int i = 0; i < count; ++i) {
+            free_msg(page[i]);
+        }
+        total += count;
+    }
+    message_cursor_close(&cursor);
+    return total;
+}
+
+// Test function for an ID stored twice, as a restarted node reusing IDs would
+void test_duplicate_ids() {
+    printf("Testing Duplicate IDs...\n");
+
+    MessageIndex index;
+    message_index_initialize(&index);
+    attach_message_index(&index);
+    clear_message_store();
+
+    // Store the same message twice, then deliver it
+    Message* repeated = create_msg("Erin", "Frank", "stored twice");
+    store_msg(repeated);
+    store_msg(repeated);
+    message_index_mark_delivered(&index, MESSAGE_STORE_FILE, repeated->id);
+
+    // Store an ID for Frank, then reuse it for Grace
+    Message* reused = create_msg("Erin", "Frank", "first use of the ID");
+    store_msg(reused);
+    free(reused->receiver);
+    reused->receiver = strdup("Grace");
+    store_msg(reused);
+    attach_message_index(NULL);
+
+    // Only the newest record of each ID counts, in the live index and in a fresh bulk load
+    MessageIndex loaded;
+    message_index_initialize(&loaded);
+    int loaded_ids = bulk_load_store(MESSAGE_STORE_FILE, &loaded, NULL, 4);
+    MessageIndex* indexes[] = { &index, &loaded };
+    int errors = loaded_ids != 2; // Four records, but only two IDs
+    for (int i = 0; i < 2; ++i) {
+        if (count_cursor_messages(indexes[i], BY_RECEIVER, "Frank", 0) != 1 ||
+            count_cursor_messages(indexes[i], BY_RECEIVER, "Frank", 1) != 0 ||
+            count_cursor_messages(indexes[i], BY_RECEIVER, "Grace", 1) != 1 ||
+            count_cursor_messages(indexes[i], BY_SENDER, "Erin", 0) != 2 ||
+            count_cursor_messages(indexes[i], BY_SENDER, "Erin", 1) != 1) {
+            printf("%s index returned a replaced record - ERROR!\n", i ? "Bulk loaded" : "Live");
+            errors++;
+        }
+    }
+    printf("Duplicate ID check: %s\n", errors ? "FAILED" : "OK");
+
+    free_msg(repeated);
+    free_msg(reused);
+    message_index_free(&loaded);
+    message_index_free(&index);
+    clear_message_store();
+}
+
 int main() {
     //clearing out message store on file first
     clear_message_store();
     test_lru_cache();
     test_random_cache();
     test_cache_performance();
+    test_template_caches();
+    test_bulk_load();
+    test_secondary_index();
+    test_duplicate_ids();
     return 0;
 }
 
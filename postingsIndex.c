@@ -0,0 +1,178 @@
+#include "postingsIndex.h"
+#include "messageIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_BUCKETS 16 // Smallest bucket table of a postings index
+
+// Forward declaration of private helper functions
+static PostingsList* find_list(const PostingsShard* shard, const char* key, size_t key_length, unsigned long hash);
+static PostingsList* reserve_list(PostingsShard* shard, unsigned long hash, const char* key, size_t key_length);
+static int rehash(PostingsShard* shard, int bucket_count);
+
+// Initialize an empty postings index
+void postings_index_initialize(PostingsIndex* index) {
+    memset(index->shards, 0, sizeof(index->shards));
+}
+
+// Free all resources used by the postings index
+void postings_index_free(PostingsIndex* index) {
+    for (int s = 0; s < POSTINGS_SHARDS; ++s) {
+        PostingsShard* shard = &index->shards[s];
+        for (int i = 0; i < shard->bucket_count; ++i) {
+            PostingsList* list = shard->buckets[i];
+            while (list) {
+                PostingsList* next = list->next;
+                free(list->key);
+                free(list->postings);
+                free(list);
+                list = next;
+            }
+        }
+        free(shard->buckets);
+    }
+    postings_index_initialize(index);
+}
+
+// Remove every posting but keep the lists, so open cursors stay valid
+void postings_index_clear(PostingsIndex* index) {
+    for (int s = 0; s < POSTINGS_SHARDS; ++s) {
+        PostingsShard* shard = &index->shards[s];
+        for (int i = 0; i < shard->bucket_count; ++i) {
+            for (PostingsList* list = shard->buckets[i]; list; list = list->next) {
+                list->count = 0;
+            }
+        }
+    }
+}
+
+// Append a posting to the list of a key, postings must be added in store order
+PostingsList* postings_index_add(PostingsIndex* index, const char* key, size_t key_length, const Posting* posting) {
+    unsigned long hash = message_index_hash(key, key_length);
+    return postings_shard_add(&index->shards[hash & (POSTINGS_SHARDS - 1)], hash, key, key_length, posting);
+}
+
+// Append a posting to one shard, the hash must be message_index_hash() of the key
+PostingsList* postings_shard_add(PostingsShard* shard, unsigned long hash, const char* key, size_t key_length,
+                                 const Posting* posting) {
+    PostingsList* list = reserve_list(shard, hash, key, key_length);
+    if (list) {
+        postings_list_append(list, posting);
+    }
+    return list;
+}
+
+// Find or create the list of a key with room for one more posting, so the next append cannot fail
+PostingsList* postings_index_reserve(PostingsIndex* index, const char* key, size_t key_length) {
+    unsigned long hash = message_index_hash(key, key_length);
+    return reserve_list(&index->shards[hash & (POSTINGS_SHARDS - 1)], hash, key, key_length);
+}
+
+// Append a posting to a list returned by postings_index_reserve()
+void postings_list_append(PostingsList* list, const Posting* posting) {
+    list->postings[list->count++] = *posting;
+}
+
+// Find the list of a key, returns NULL if no record has it
+PostingsList* postings_index_find(const PostingsIndex* index, const char* key) {
+    size_t key_length = strlen(key);
+    unsigned long hash = message_index_hash(key, key_length);
+    return find_list(&index->shards[hash & (POSTINGS_SHARDS - 1)], key, key_length, hash);
+}
+
+// Find the posting of the record at an offset, returns NULL if the list does not hold it
+Posting* postings_list_find(PostingsList* list, long offset) {
+    // Postings are sorted by offset, so a binary search finds the record
+    int low = 0;
+    int high = list->count - 1;
+
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (list->postings[middle].offset == offset) {
+            return &list->postings[middle];
+        }
+        if (list->postings[middle].offset < offset) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+// Look a key up in its bucket
+static PostingsList* find_list(const PostingsShard* shard, const char* key, size_t key_length, unsigned long hash) {
+    if (shard->bucket_count == 0) {
+        return NULL;
+    }
+
+    PostingsList* list = shard->buckets[(hash >> 6) & (shard->bucket_count - 1)];
+    while (list && (strncmp(list->key, key, key_length) != 0 || list->key[key_length] != '\0')) {
+        list = list->next;
+    }
+    return list;
+}
+
+// Find or create the list of a key and grow it so one more posting fits
+static PostingsList* reserve_list(PostingsShard* shard, unsigned long hash, const char* key, size_t key_length) {
+    PostingsList* list = find_list(shard, key, key_length, hash);
+
+    if (!list) {
+        // Keep at most one key per bucket on average
+        if (shard->key_count >= shard->bucket_count) {
+            if (rehash(shard, shard->bucket_count ? shard->bucket_count * 2 : MIN_BUCKETS) != 0) {
+                return NULL;
+            }
+        }
+
+        list = calloc(1, sizeof(PostingsList));
+        if (!list) {
+            return NULL; // Memory allocation failed
+        }
+        list->key = strndup(key, key_length);
+        if (!list->key) {
+            free(list);
+            return NULL; // Memory allocation failed
+        }
+
+        int bucket = (hash >> 6) & (shard->bucket_count - 1);
+        list->next = shard->buckets[bucket];
+        shard->buckets[bucket] = list;
+        shard->key_count++;
+    }
+
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        Posting* postings = realloc(list->postings, capacity * sizeof(Posting));
+        if (!postings) {
+            return NULL; // Memory allocation failed
+        }
+        list->postings = postings;
+        list->capacity = capacity;
+    }
+    return list;
+}
+
+// Move every list into a bucket table of a new size
+static int rehash(PostingsShard* shard, int bucket_count) {
+    PostingsList** buckets = calloc(bucket_count, sizeof(PostingsList*));
+    if (!buckets) {
+        return -1; // Memory allocation failed
+    }
+
+    for (int i = 0; i < shard->bucket_count; ++i) {
+        PostingsList* list = shard->buckets[i];
+        while (list) {
+            PostingsList* next = list->next;
+            int bucket = (message_index_hash(list->key, strlen(list->key)) >> 6) & (bucket_count - 1);
+            list->next = buckets[bucket];
+            buckets[bucket] = list;
+            list = next;
+        }
+    }
+
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = bucket_count;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef POSTINGSINDEX_H
+#define POSTINGSINDEX_H
+
+#include <stddef.h>
+
+#define POSTINGS_SHARDS 64 // Number of independent hash tables in a postings index, must be a power of 2
+
+// A postings index maps one field value, such as a receiver name, to the list of every record that has it. The
+// store file is append only, so a record stored later always sits at a larger offset. Appending postings in
+// store order therefore keeps every list sorted by time for free: the newest record is always the last posting.
+// Each list keeps a copy of the delivered flag so queries for undelivered messages never touch the file.
+// When an ID is stored again, the ID index keeps only the newest record, so the older postings of that ID are
+// flagged as superseded and skipped by queries.
+
+// The lists are hash table nodes chained by pointer, like the LRU cache, and each one owns a growable array of
+// postings. A list node is never freed until the whole index is, so a cursor can keep a pointer to it while new
+// messages are stored. Like the ID index, the table is split into shards chosen by the hash of the key, so the
+// bulk loader can build every shard at the same time without locking.
+
+typedef struct {
+    long offset;    // Byte offset of the record in the store file.
+    int length;     // Length of the record, without the newline.
+    int delivered;  // Copy of the delivered flag of the record.
+    int superseded; // Set once a newer record with the same ID is stored.
+} Posting;
+
+typedef struct PostingsList {
+    char* key;                 // Field value shared by every record of the list.
+    Posting* postings;         // Records in store order, oldest first.
+    int count;                 // Number of postings in use.
+    int capacity;              // Number of postings allocated.
+    struct PostingsList* next; // Next list in the same bucket.
+} PostingsList;
+
+typedef struct {
+    PostingsList** buckets; // Hash table of lists by key.
+    int bucket_count;       // Number of buckets, always a power of 2.
+    int key_count;          // Number of distinct keys.
+} PostingsShard;
+
+typedef struct {
+    PostingsShard shards[POSTINGS_SHARDS];
+} PostingsIndex;
+
+// Initialize an empty postings index
+void postings_index_initialize(PostingsIndex* index);
+
+// Free all resources used by the postings index
+void postings_index_free(PostingsIndex* index);
+
+// Remove every posting but keep the lists, so open cursors stay valid
+void postings_index_clear(PostingsIndex* index);
+
+// Append a posting to the list of a key, postings must be added in store order. Returns the list, NULL on error
+PostingsList* postings_index_add(PostingsIndex* index, const char* key, size_t key_length, const Posting* posting);
+
+// Find or create the list of a key with room for one more posting, so the next append cannot fail. Lets a
+// caller prepare several lists before changing any of them. Returns the list, NULL on error
+PostingsList* postings_index_reserve(PostingsIndex* index, const char* key, size_t key_length);
+
+// Append a posting to a list returned by postings_index_reserve(), postings must be added in store order
+void postings_list_append(PostingsList* list, const Posting* posting);
+
+// Find the list of a key, returns NULL if no record has it
+PostingsList* postings_index_find(const PostingsIndex* index, const char* key);
+
+// Append a posting to one shard, the hash must be message_index_hash() of the key. Returns the list, NULL on error
+PostingsList* postings_shard_add(PostingsShard* shard, unsigned long hash, const char* key, size_t key_length,
+                                 const Posting* posting);
+
+// Find the posting of the record at an offset, returns NULL if the list does not hold it
+Posting* postings_list_find(PostingsList* list, long offset);
+
+#endif /* POSTINGSINDEX_H */
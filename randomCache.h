@@ -3,7 +3,9 @@
 
 #include "message.h"
 
+#ifndef MAX_CACHE_SIZE // Shared with the other cache header
 #define MAX_CACHE_SIZE 16 // Maximum number of messages in cache
+#endif
 
 //I implement my random cache simply using an array because I can add/remove items from anywhere in they array.
 //For a random cache, where the order of elements doesn't matter, an array provides an easy way to store items.